@@ -0,0 +1,93 @@
+// A tiny consumer of `doomfire --shm <name>`. Maps the ring read-only and, once per newly published frame, checks that
+// every palette index is within the palette and that frame numbers only go forward. Reads never copy the frame and
+// never make a syscall, the polling sleep is only there to keep this example from spinning a core.
+//
+// Usage: doomfire_shm_reader <name> [frames]
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/sinks/SharedMemoryProtocol.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <name> [frames]" << std::endl;
+        return 1;
+    }
+
+    const std::string name = argv[1][0] == '/' ? argv[1] : std::string("/") + argv[1];
+    const uint64_t frames_wanted = argc > 2 ? std::stoull(argv[2]) : 100;
+
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "shm_open(" << name << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    struct stat st{};
+    fstat(fd, &st);
+    void *memory = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "mmap(" << name << "): " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    const auto *header = static_cast<const ShmHeader *>(memory);
+    if (std::memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 || header->version != SHM_VERSION) {
+        std::cerr << name << " is not a DoomFire frame ring (or a different version of one)" << std::endl;
+        return 1;
+    }
+
+    uint64_t frames_read = 0, torn_reads = 0, bad_frames = 0;
+    uint64_t last_frame = 0;
+    bool have_frame = false;
+
+    while (frames_read < frames_wanted) {
+        const ShmSlotHeader *slot = shmLatestSlot(header);
+        uint32_t sequence;
+
+        if (slot == nullptr || !shmBeginRead(slot, sequence) || (have_frame && slot->frame == last_frame)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        const uint64_t frame = slot->frame;
+        const uint32_t width = slot->width;
+        const uint32_t height = slot->height;
+        const uint32_t palette_size = slot->palette_size;
+        const uint16_t *indices = shmIndices(header, slot);
+
+        bool valid = width <= header->max_width && height <= header->max_height;
+        for (size_t i = 0; valid && i < (size_t) width * height; i++) {
+            if (indices[i] >= palette_size) valid = false;
+        }
+
+        if (!shmEndRead(slot, sequence)) {
+            torn_reads++;
+            continue;
+        }
+
+        if (!valid || (have_frame && frame < last_frame)) bad_frames++;
+
+        last_frame = frame;
+        have_frame = true;
+        frames_read++;
+    }
+
+    std::cout << "read " << frames_read << " frames, last #" << last_frame
+              << ", " << torn_reads << " retried, " << bad_frames << " invalid" << std::endl;
+
+    munmap(memory, (size_t) st.st_size);
+
+    return bad_frames == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ControlSocket.h"
+
+// Lines longer than this are dropped rather than buffered forever.
+static const size_t MAX_LINE_LENGTH = 4096;
+
+// MSG_NOSIGNAL is Linux only. Elsewhere SO_NOSIGPIPE on each socket keeps a client hanging up from raising SIGPIPE.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Makes a socket non-blocking and keeps it out of child processes. Done with fcntl rather than the SOCK_NONBLOCK and
+// SOCK_CLOEXEC socket flags, which are Linux only.
+static bool setSocketFlags(const int fd) {
+#ifdef SO_NOSIGPIPE
+    const int on = 1;
+    (void) setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+// A new non-blocking Unix domain stream socket, or -1 with errno set.
+static int openSocket() {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || setSocketFlags(fd)) return fd;
+
+    const int error = errno;
+    ::close(fd);
+    errno = error;
+    return -1;
+}
+
+ControlSocket::~ControlSocket() {
+    close();
+}
+
+// Starts listening on path. A socket left behind by a previous run is replaced, but nothing else is: not a file which
+// isn't a socket, and not the socket of an instance that is still running.
+bool ControlSocket::open(const std::string &path) {
+    close();
+
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        _error = "control socket path is too long: " + path;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    _listen_fd = openSocket();
+    if (_listen_fd < 0) {
+        _error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+
+    if (!_removeStale(path, address)) {
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+
+    if (bind(_listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(_listen_fd, 4) != 0) {
+        _error = "bind(" + path + "): " + std::strerror(errno);
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+
+    _path = path;
+    return true;
+}
+
+// Removes the socket at path if nobody is listening on it anymore. Returns false and sets the error message if there's
+// something at path which we must not remove.
+bool ControlSocket::_removeStale(const std::string &path, const sockaddr_un &address) {
+    struct stat st{};
+    if (lstat(path.c_str(), &st) != 0) {
+        if (errno == ENOENT) return true;
+
+        _error = "lstat(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+
+    if (!S_ISSOCK(st.st_mode)) {
+        _error = path + " already exists and isn't a socket, not replacing it";
+        return false;
+    }
+
+    // Only a socket nobody is listening on refuses connections. Anything else is left alone. The probe doesn't block,
+    // so a live instance with a full backlog (stopped, or just not accepting) fails with EAGAIN or EINPROGRESS instead
+    // of hanging us.
+    const int probe = openSocket();
+    if (probe < 0) {
+        _error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+    const bool connected = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    const int connect_error = errno;
+    ::close(probe);
+
+    if (connected || connect_error == EAGAIN || connect_error == EWOULDBLOCK || connect_error == EINPROGRESS) {
+        _error = path + " is in use by another running instance";
+        return false;
+    } else if (connect_error != ECONNREFUSED) {
+        _error = "connect(" + path + "): " + std::strerror(connect_error);
+        return false;
+    }
+
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        _error = "unlink(" + path + "): " + std::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+// Disconnects every client and removes the socket file.
+void ControlSocket::close() {
+    for (auto &client : _clients) ::close(client.fd);
+    _clients.clear();
+
+    if (_listen_fd < 0) return;
+
+    ::close(_listen_fd);
+    unlink(_path.c_str());
+    _listen_fd = -1;
+}
+
+// Accepts pending connections and appends every complete line received since the last call to commands.
+void ControlSocket::poll(std::vector<ControlCommand> &commands) {
+    if (_listen_fd < 0) return;
+
+    _accept();
+
+    // Clients which hung up are only closed one poll later, so that replies to their last commands never go to a
+    // reused file descriptor.
+    _clients.erase(std::remove_if(_clients.begin(), _clients.end(), [](const Client &client) {
+        if (client.hung_up) ::close(client.fd);
+        return client.hung_up;
+    }), _clients.end());
+
+    for (auto &client : _clients) {
+        if (!_read(client, commands)) client.hung_up = true;
+    }
+}
+
+// Sends a single line back to a client. Replies are short, so if the client isn't reading we just drop them.
+void ControlSocket::reply(const int client, const std::string &message) {
+    const std::string line = message + "\n";
+    (void) send(client, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+void ControlSocket::_accept() {
+    while (true) {
+        const int fd = accept(_listen_fd, nullptr, nullptr);
+        if (fd < 0) return;
+
+        if (!setSocketFlags(fd)) {
+            ::close(fd);
+            continue;
+        }
+
+        _clients.push_back(Client{fd, std::string(), false});
+    }
+}
+
+// Reads whatever the client sent and splits off complete lines. Returns false once the client should be dropped.
+bool ControlSocket::_read(Client &client, std::vector<ControlCommand> &commands) {
+    char buffer[1024];
+
+    while (true) {
+        const ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+
+        if (received == 0) return false;
+        if (received < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        client.pending.append(buffer, (size_t) received);
+
+        size_t line_end;
+        while ((line_end = client.pending.find('\n')) != std::string::npos) {
+            std::istringstream line(client.pending.substr(0, line_end));
+            client.pending.erase(0, line_end + 1);
+
+            ControlCommand command{client.fd, {}};
+            std::string word;
+            while (line >> word) command.words.push_back(word);
+
+            if (!command.words.empty()) commands.push_back(std::move(command));
+        }
+
+        if (client.pending.size() > MAX_LINE_LENGTH) return false;
+    }
+}
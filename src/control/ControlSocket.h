@@ -0,0 +1,59 @@
+#ifndef DOOMFIRE_CONTROLSOCKET_H
+#define DOOMFIRE_CONTROLSOCKET_H
+
+#include <string>
+#include <vector>
+
+struct sockaddr_un;
+
+// One line received from a control client, split on whitespace.
+struct ControlCommand {
+    int client;
+    std::vector<std::string> words;
+};
+
+// A Unix domain socket which accepts line based commands, e.g. `echo "set fps 35" | nc -U /tmp/doomfire.sock`.
+// Nothing here ever blocks: the main loop calls poll() between ticks to collect whatever arrived since the last one.
+class ControlSocket {
+public:
+    ControlSocket() = default;
+
+    ControlSocket(const ControlSocket &) = delete;
+
+    ControlSocket &operator=(const ControlSocket &) = delete;
+
+    ~ControlSocket();
+
+    bool open(const std::string &path);
+
+    void close();
+
+    bool isOpen() const { return _listen_fd >= 0; }
+
+    void poll(std::vector<ControlCommand> &commands);
+
+    void reply(int client, const std::string &message);
+
+    const std::string &getError() const { return _error; }
+
+private:
+    struct Client {
+        int fd;
+        std::string pending; // Bytes received after the last complete line.
+        bool hung_up;
+    };
+
+    std::string _path;
+    std::string _error;
+    int _listen_fd = -1;
+    std::vector<Client> _clients;
+
+    void _accept();
+
+    bool _read(Client &, std::vector<ControlCommand> &commands);
+
+    bool _removeStale(const std::string &path, const sockaddr_un &address);
+};
+
+
+#endif //DOOMFIRE_CONTROLSOCKET_H
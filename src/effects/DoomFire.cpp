@@ -3,36 +3,81 @@
 //
 
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
 #include <SFML/Graphics/Image.hpp>
 
 #include "DoomFire.h"
 
-// Generates a random number.
-double DoomFire::_rnd() {
-    float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-    return (double) r;
-}
+// Header of a snapshot file. It's followed directly by the grid's cells, _cell_size bytes each, in the machine's byte
+// order. Snapshots are a cache, not an interchange format, so anything that doesn't match exactly is simply rejected.
+struct FireSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cell_size;
+    uint64_t width;
+    uint64_t height;
+    uint64_t palette_size;
+    uint64_t seed;
+    uint64_t rng_state;
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'D', 'F', 'S', 'N', 'A', 'P', '\0', '\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
 
 // Initializes our fire.
 // At its core our fire generator is basically cellular automata. So we keep those cells in a vector of size
 // DEFAULT_WIDTH * DEFAULT_HEIGHT. While we could use multidimensional arrays or a 2d vector the original algorithm uses some old-school
 // pointer math to propagate the flames, so in this implementation we're using a 1d vector of length DEFAULT_WIDTH * DEFAULT_HEIGHT.
-// This method accepts a boolean to determine if we should use a single white line of pixels as our source, or if we
-// should use randomly colored pixels as our source. From there it iterates over the vector and pre-fills it with our
-// starting colors.
+// The cells are as small as the palette allows, and the spreading kernel is picked to match the cell size and width.
+// From there it iterates over the vector and pre-fills it with our starting colors.
 void DoomFire::_initFire() {
-    _fireCells = std::vector<size_t>(_fire_size);
+    // Every fresh grid starts the random sequence over, so the same configuration always plays out the same way.
+    _rng = FireRng{_seed != 0 ? _seed : DEFAULT_SEED};
+    _cell_size = fireCellSize(_palette_size);
+    _spread_kernel = selectSpreadFireKernel(_palette_size, _width);
 
-    // Fill vector with defaults
-    for (size_t y = 0; y < _height; y++) {
-        for (size_t x = 0; x < _width; x++) {
-            if (y == _height - 1) // Bottom row is white (max palette index).
-                // "Hottest" color, in our case white.
-                _fireCells[y * _width + x] = _palette_size - 1;
+    // assign() reuses the existing allocation whenever it's big enough. Everything starts out black (palette index 0).
+    const size_t cells = _fire_size + FIRE_PADDING;
+    _cells8.assign(_cell_size == sizeof(uint8_t) ? cells : 0, 0);
+    _cells16.assign(_cell_size == sizeof(uint16_t) ? cells : 0, 0);
+    _cells32.assign(_cell_size == sizeof(uint32_t) ? cells : 0, 0);
 
-            else // Rest of cells are black (palette index 0).
-                _fireCells[y * _width + x] = 0;
-        }
+    // Bottom row is white (max palette index). "Hottest" color, in our case white.
+    for (size_t x = 0; x < _width; x++) {
+        _setCell((_height - 1) * _width + x, _palette_size - 1);
+    }
+}
+
+// The start of the grid in whichever cell vector is in use.
+void *DoomFire::_grid() {
+    return const_cast<void *>(static_cast<const DoomFire *>(this)->_grid());
+}
+
+const void *DoomFire::_grid() const {
+    switch (_cell_size) {
+        case sizeof(uint8_t):
+            return _cells8.data() + FIRE_PADDING;
+        case sizeof(uint16_t):
+            return _cells16.data() + FIRE_PADDING;
+        default:
+            return _cells32.data() + FIRE_PADDING;
+    }
+}
+
+void DoomFire::_setCell(const size_t idx, const size_t palette_idx) {
+    switch (_cell_size) {
+        case sizeof(uint8_t):
+            _cells8[idx + FIRE_PADDING] = (uint8_t) palette_idx;
+            break;
+        case sizeof(uint16_t):
+            _cells16[idx + FIRE_PADDING] = (uint16_t) palette_idx;
+            break;
+        default:
+            _cells32[idx + FIRE_PADDING] = (uint32_t) palette_idx;
+            break;
     }
 }
 
@@ -42,23 +87,18 @@ DoomFire::DoomFire(
         const size_t h,
         const size_t palette_size,
         const bool use_hsv,
-        const InterpolationFunction::InterpolationFunction interpolation_function
+        const InterpolationFunction::InterpolationFunction interpolation_function,
+        const uint64_t seed
 ) {
     _width = w;
     _height = h;
     _fire_size = w * h;
     _palette_size = palette_size;
     _use_hsv = use_hsv;
+    _seed = seed;
     _classic_palette = _generateClassicPalette();
 
-    switch (interpolation_function) {
-        case InterpolationFunction::Linear:
-            _interpolation_function = interpolateLinear;
-            break;
-        case InterpolationFunction::Cosine:
-            _interpolation_function = interpolateCosine;
-            break;
-    }
+    _setInterpolation(interpolation_function);
 
     _palette = _generatePalette();
 
@@ -72,7 +112,7 @@ sf::Image DoomFire::getImage() {
 
     for (size_t y = 0; y < _height; y++) {
         for (size_t x = 0; x < _width; x++) {
-            size_t palette_idx = _fireCells[y * _width + x];
+            size_t palette_idx = getCell(y * _width + x);
 
             sf::Color pixel_color = _palette[palette_idx];
 
@@ -87,7 +127,7 @@ sf::Image DoomFire::getImage() {
 void DoomFire::getImage(sf::Image &img) {
     for (size_t y = 0; y < _height; y++) {
         for (size_t x = 0; x < _width; x++) {
-            const size_t palette_idx = _fireCells[y * _width + x];
+            const size_t palette_idx = getCell(y * _width + x);
             const sf::Color pixel_color = _palette[palette_idx];
 
             img.setPixel(x, y, pixel_color);
@@ -95,41 +135,83 @@ void DoomFire::getImage(sf::Image &img) {
     }
 }
 
-// This simple iterates over our cells and calls our actual update function.
+// Runs one tick of the simulation using the kernel picked for our cell size and width. The spreading logic itself is
+// mostly cribbed directly from the source material, see ClassicSpread in FireKernels.h.
 void DoomFire::doFire() {
-    // Starting at horizontal line 1 prevents overwriting the bottom source line of pixels and prevents an integer
-    // underflow from occuring later in spreadFire
-    for (size_t y = 1; y < _height; y++) {
-        for (size_t x = 0; x < _width; x++) {
-            spreadFire(y * _width + x);
-        }
+    _spread_kernel(_grid(), _width, _height, _rng);
+}
+
+// Runs the simulation without drawing anything, e.g. to get from the all black starting grid to burning flames.
+void DoomFire::fastForward(const size_t ticks) {
+    for (size_t i = 0; i < ticks; i++) doFire();
+}
+
+// Writes our cells and rng state to path. The file is written under a temporary name and renamed into place, so a
+// concurrent loadSnapshot never sees half a snapshot.
+bool DoomFire::saveSnapshot(const std::string &path) const {
+    FireSnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.cell_size = (uint32_t) _cell_size;
+    header.width = _width;
+    header.height = _height;
+    header.palette_size = _palette_size;
+    header.seed = _seed;
+    header.rng_state = _rng.state;
+
+    // A random suffix keeps two instances saving the same snapshot from writing into each other's temporary file.
+    const std::string temp_path = path + "." + std::to_string(std::random_device()()) + ".tmp";
+
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(static_cast<const char *>(_grid()), (std::streamsize) (_fire_size * _cell_size));
+    file.close();
+
+    if (!file || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
     }
+
+    return true;
 }
 
-// This is where the flames happen! This logic is mostly cribbed directly from the source material.
-void DoomFire::spreadFire(size_t src_idx) {
-    // src_idx: this is the location of the current cell in _fireCells
-    const size_t palette_idx = _fireCells[src_idx]; // palette_idx: the actual color value of the src palette_idx.
+// Replaces our cells and rng state with a snapshot written by saveSnapshot. The cells are read straight into place.
+// Returns false if the file is missing or was made for a different width, height, palette size or seed, and resets the
+// fire if its cells turn out to be damaged.
+bool DoomFire::loadSnapshot(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
 
-    if (palette_idx == 0) { // Black
-        // If our palette_idx is already black then we propagate the value down one row.
-        src_idx = src_idx - _width;
-        _fireCells[src_idx] = 0;
-    } else {
-        // rnd_idx: this is a random index within 3 pixels.
-        // The way this works is as follows:
-        // 1) We get a random number between 0.0 and 1.0 inclusive.
-        // 2) We multiply that by 3 to get a number between 0.0 and 3.0 inclusive.
-        // 3) We floor that value to get an integer.
-        // 4) We logically AND that value with 3 which clamps our value.
-        const size_t rnd_idx = (size_t) floor(_rnd() * 3.0) & (unsigned int) 3;
-        // We then use this random index to offset our destination value. We add 1 here to avoid negative indices.
-        const size_t dst = src_idx - rnd_idx + 1;
-        // We move up one row
-        const size_t dst_idx = dst - _width;
-        // Finally we set the palette_idx value to either 1 less than the current color, or the current color.
-        _fireCells[dst_idx] = palette_idx - (rnd_idx & (size_t) 1);
+    FireSnapshotHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    const bool header_valid = file &&
+                              std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 &&
+                              header.version == SNAPSHOT_VERSION &&
+                              header.cell_size == _cell_size &&
+                              header.width == _width &&
+                              header.height == _height &&
+                              header.palette_size == _palette_size &&
+                              header.seed == _seed &&
+                              header.rng_state != 0;
+    if (!header_valid) return false;
+
+    // The cells have to fill the rest of the file exactly, a longer file is caught by there being anything left.
+    file.read(static_cast<char *>(_grid()), (std::streamsize) (_fire_size * _cell_size));
+    const bool valid = file && file.peek() == std::ifstream::traits_type::eof();
+
+    // Even a matching header can sit in front of damaged cells, and an index past the palette would read out of bounds.
+    bool cells_valid = valid;
+    for (size_t i = 0; cells_valid && i < _fire_size; i++) cells_valid = getCell(i) < _palette_size;
+
+    if (!cells_valid) {
+        // The cells may have been partially overwritten, so start over.
+        _initFire();
+        return false;
     }
+
+    _rng.state = header.rng_state;
+    return true;
 }
 
 // This draws a checkerboard in our color palette gradient.
@@ -141,9 +223,9 @@ void DoomFire::drawCheck() {
     for (size_t y = 0; y < (_height - 1); y++) {
         for (size_t x = 0; x < _width; x++) {
             if (is_color_pixel)
-                _fireCells[y * _width + x] = (_palette_size - 1);
+                _setCell(y * _width + x, _palette_size - 1);
             else
-                _fireCells[y * _width + x] = color_index;
+                _setCell(y * _width + x, color_index);
 
             // Every 8th flip colour
             if (!(x % 8)) {
@@ -161,6 +243,20 @@ void DoomFire::drawCheck() {
 
 // Resizes and re-initializes our simulation.
 void DoomFire::resize(size_t w, size_t h) {
+    // Grab the memory up front, so that if there isn't enough we throw before anything has changed.
+    const size_t cells = w * h + FIRE_PADDING;
+    switch (_cell_size) {
+        case sizeof(uint8_t):
+            _cells8.reserve(cells);
+            break;
+        case sizeof(uint16_t):
+            _cells16.reserve(cells);
+            break;
+        default:
+            _cells32.reserve(cells);
+            break;
+    }
+
     _width = w;
     _height = h;
     _fire_size = w * h;
@@ -168,6 +264,87 @@ void DoomFire::resize(size_t w, size_t h) {
     _initFire();
 }
 
+// Swaps in a new palette between ticks. The cells are kept: when the palette size changes their indices are scaled to
+// the new size so the flames keep their shape, and they're only reallocated if they need a different cell size.
+// Everything that allocates happens before the fire is changed, so if it throws the fire is left as it was.
+void DoomFire::setPalette(
+        const size_t palette_size,
+        const bool use_hsv,
+        const InterpolationFunction::InterpolationFunction interpolation_function
+) {
+    const size_t old_palette_size = _palette_size;
+    const bool old_use_hsv = _use_hsv;
+    const InterpolationFunction::InterpolationFunction old_interpolation = _interpolation;
+
+    // Maps old indices onto the new palette, keeping black black and the hottest color the hottest color.
+    const auto rescale = [&](const size_t palette_idx) -> size_t {
+        if (old_palette_size < 2) return palette_size - 1;
+        return palette_idx * (palette_size - 1) / (old_palette_size - 1);
+    };
+
+    const size_t cell_size = fireCellSize(palette_size);
+    const bool new_cells = palette_size != old_palette_size && cell_size != _cell_size;
+
+    // Build the new palette (and cells, if they change size) off to the side, so that _palette is only ever one
+    // complete palette or the other.
+    std::vector<sf::Color> palette;
+    std::vector<uint32_t> indices;
+    std::vector<uint8_t> cells8;
+    std::vector<uint16_t> cells16;
+    std::vector<uint32_t> cells32;
+    try {
+        _palette_size = palette_size;
+        _use_hsv = use_hsv;
+        _setInterpolation(interpolation_function);
+        palette = _generatePalette();
+
+        if (new_cells) {
+            indices.resize(_fire_size);
+            for (size_t i = 0; i < _fire_size; i++) indices[i] = (uint32_t) rescale(getCell(i));
+
+            const size_t cells = _fire_size + FIRE_PADDING;
+            cells8.assign(cell_size == sizeof(uint8_t) ? cells : 0, 0);
+            cells16.assign(cell_size == sizeof(uint16_t) ? cells : 0, 0);
+            cells32.assign(cell_size == sizeof(uint32_t) ? cells : 0, 0);
+        }
+    } catch (...) {
+        _palette_size = old_palette_size;
+        _use_hsv = old_use_hsv;
+        _setInterpolation(old_interpolation);
+        throw;
+    }
+
+    _palette.swap(palette);
+
+    if (palette_size == old_palette_size) return;
+
+    if (!new_cells) {
+        for (size_t i = 0; i < _fire_size; i++) _setCell(i, rescale(getCell(i)));
+    } else {
+        _cell_size = cell_size;
+        _cells8.swap(cells8);
+        _cells16.swap(cells16);
+        _cells32.swap(cells32);
+
+        for (size_t i = 0; i < _fire_size; i++) _setCell(i, indices[i]);
+    }
+
+    _spread_kernel = selectSpreadFireKernel(_palette_size, _width);
+}
+
+void DoomFire::_setInterpolation(const InterpolationFunction::InterpolationFunction interpolation_function) {
+    _interpolation = interpolation_function;
+
+    switch (interpolation_function) {
+        case InterpolationFunction::Linear:
+            _interpolation_function = interpolateLinear;
+            break;
+        case InterpolationFunction::Cosine:
+            _interpolation_function = interpolateCosine;
+            break;
+    }
+}
+
 // I have plans to replace with a multi-color gradient palette generator which can generate this or any other
 // color palette of an arbitrary length.
 std::vector<sf::Color> DoomFire::_generatePalette() {
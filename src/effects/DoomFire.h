@@ -6,13 +6,18 @@
 #define DOOMFIRE_DOOMFIRE_H
 
 
+#include <cstdint>
 #include <random>
 #include <functional>
+#include <string>
+#include <vector>
 
 #include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Image.hpp>
 
 #include "../libs/ColorUtils.h"
 #include "../libs/DefaultValues.h"
+#include "FireKernels.h"
 
 class DoomFire {
 public:
@@ -21,7 +26,8 @@ public:
             size_t h,
             size_t = CLASSIC_PALETTE_SIZE,
             bool hsv = false,
-            InterpolationFunction::InterpolationFunction = InterpolationFunction::Linear
+            InterpolationFunction::InterpolationFunction = InterpolationFunction::Linear,
+            uint64_t seed = DEFAULT_SEED
     );
 
     sf::Image getImage();
@@ -30,12 +36,44 @@ public:
 
     void doFire();
 
-    void spreadFire(size_t);
+    void fastForward(size_t ticks);
+
+    bool saveSnapshot(const std::string &path) const;
+
+    bool loadSnapshot(const std::string &path);
 
     void drawCheck();
 
     void resize(size_t, size_t);
 
+    void setPalette(size_t, bool, InterpolationFunction::InterpolationFunction);
+
+    size_t getWidth() const { return _width; }
+
+    size_t getHeight() const { return _height; }
+
+    size_t getPaletteSize() const { return _palette_size; }
+
+    uint64_t getSeed() const { return _seed; }
+
+    bool getHsv() const { return _use_hsv; }
+
+    InterpolationFunction::InterpolationFunction getInterpolation() const { return _interpolation; }
+
+    const std::vector<sf::Color> &getPalette() const { return _palette; }
+
+    // Palette index of a single cell. Kept inline since renderers call this once per pixel.
+    size_t getCell(size_t idx) const {
+        switch (_cell_size) {
+            case sizeof(uint8_t):
+                return _cells8[idx + FIRE_PADDING];
+            case sizeof(uint16_t):
+                return _cells16[idx + FIRE_PADDING];
+            default:
+                return _cells32[idx + FIRE_PADDING];
+        }
+    }
+
 private:
     size_t _width;
     size_t _height;
@@ -45,15 +83,31 @@ private:
     std::vector<sf::Color> _classic_palette;
     std::vector<sf::Color> _palette;
 
+    InterpolationFunction::InterpolationFunction _interpolation;
     double (*_interpolation_function)(double, double, double);
 
-    std::vector<size_t> _fireCells;
+    // Our cells, sized to fit the palette. Only the vector matching _cell_size is in use, the others stay empty.
+    // Each has FIRE_PADDING spare cells in front of the actual grid, see FireKernels.h.
+    size_t _cell_size;
+    std::vector<uint8_t> _cells8;
+    std::vector<uint16_t> _cells16;
+    std::vector<uint32_t> _cells32;
+
+    SpreadFireKernel _spread_kernel;
+    uint64_t _seed;
+    FireRng _rng;
 
     void _initFire();
 
-    std::vector<sf::Color> _generatePalette();
+    void *_grid();
 
-    static double _rnd();
+    const void *_grid() const;
+
+    void _setCell(size_t, size_t);
+
+    void _setInterpolation(InterpolationFunction::InterpolationFunction);
+
+    std::vector<sf::Color> _generatePalette();
 
     static std::vector<sf::Color> _generateClassicPalette() {
         return std::vector<sf::Color>{
@@ -0,0 +1,68 @@
+#include <limits>
+
+#include "FireKernels.h"
+
+namespace {
+    struct KernelEntry {
+        size_t cell_size;
+        size_t width; // 0 matches any width.
+        bool needs_block_alignment;
+        SpreadFireKernel kernel;
+    };
+
+    template<typename Cell, size_t Width>
+    constexpr KernelEntry fixedWidth() {
+        return KernelEntry{sizeof(Cell), Width, false, spreadFireKernel<Cell, Width, true, ClassicSpread>};
+    }
+
+    template<typename Cell>
+    constexpr KernelEntry anyAlignedWidth() {
+        return KernelEntry{sizeof(Cell), 0, true, spreadFireKernel<Cell, 0, true, ClassicSpread>};
+    }
+
+    template<typename Cell>
+    constexpr KernelEntry anyWidth() {
+        return KernelEntry{sizeof(Cell), 0, false, spreadFireKernel<Cell, 0, false, ClassicSpread>};
+    }
+
+    // Searched top to bottom, so more specialized kernels come first. Both the classic (38) and default (60) palettes
+    // use one byte cells. Palettes over 256 entries (tall fires) get two byte cells, and anything bigger still falls
+    // through to the four byte kernels at the end.
+    const KernelEntry KERNELS[] = {
+            fixedWidth<uint8_t, 320>(),
+            fixedWidth<uint8_t, 640>(),
+            fixedWidth<uint8_t, 1920>(),
+            fixedWidth<uint8_t, 3840>(),
+            anyAlignedWidth<uint8_t>(),
+            anyWidth<uint8_t>(),
+
+            fixedWidth<uint16_t, 1920>(),
+            fixedWidth<uint16_t, 3840>(),
+            anyAlignedWidth<uint16_t>(),
+            anyWidth<uint16_t>(),
+
+            anyWidth<uint32_t>(),
+    };
+}
+
+size_t fireCellSize(const size_t palette_size) {
+    if (palette_size <= (size_t) std::numeric_limits<uint8_t>::max() + 1) return sizeof(uint8_t);
+    if (palette_size <= (size_t) std::numeric_limits<uint16_t>::max() + 1) return sizeof(uint16_t);
+
+    return sizeof(uint32_t);
+}
+
+SpreadFireKernel selectSpreadFireKernel(const size_t palette_size, const size_t width) {
+    const size_t cell_size = fireCellSize(palette_size);
+
+    for (const auto &entry : KERNELS) {
+        if (entry.cell_size != cell_size) continue;
+        if (entry.width != 0 && entry.width != width) continue;
+        if (entry.needs_block_alignment && width % FIRE_BLOCK != 0) continue;
+
+        return entry.kernel;
+    }
+
+    // Unreachable as long as the table ends with a generic kernel for every cell size.
+    return spreadFireKernel<uint32_t, 0, false, ClassicSpread>;
+}
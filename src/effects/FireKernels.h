@@ -0,0 +1,136 @@
+#ifndef DOOMFIRE_FIREKERNELS_H
+#define DOOMFIRE_FIREKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The simulation core. Each kernel runs one full tick of the fire over a grid of cells. The kernels are templates so
+// that the compiler can specialize them on the things it would otherwise have to check at runtime: how big a cell is,
+// the width of the grid, whether the width is a whole number of blocks and how heat spreads. The common
+// configurations are instantiated up front in FireKernels.cpp and picked from a table when the fire is created.
+
+// A small, fast random number generator (xorshift64*). Unlike rand() its whole state is a single number, which makes
+// it cheap and easy to save and restore.
+struct FireRng {
+    uint64_t state;
+
+    uint64_t next() {
+        state ^= state >> 12u;
+        state ^= state << 25u;
+        state ^= state >> 27u;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+// Cells are processed in blocks of this many. Each block uses one 64 bit random number, one byte per cell.
+constexpr size_t FIRE_BLOCK = 8;
+
+// The grids handed to the kernels have this many spare cells in front of them. The classic algorithm can write one cell
+// before the start of the grid (the leftmost cell of the second row drifting left), which lands here instead of out of
+// bounds.
+constexpr size_t FIRE_PADDING = 1;
+
+// Which way a cell's heat moves on its way up a row. Stored in the same type as the cells so that the kernels don't
+// mix element sizes, which keeps their loops vectorizable.
+constexpr unsigned int FIRE_DRIFT_RIGHT = 0;
+constexpr unsigned int FIRE_DRIFT_UP = 1;
+constexpr unsigned int FIRE_DRIFT_LEFT = 2;
+
+// The spreading rule from the original game. `rnd` is 0, 1 or 2. Heat moves up one row, drifting one cell right,
+// straight up or one cell left, and cools by one step when it goes straight up. Black cells just propagate black.
+// Produces the new heat and which way it goes (one of the FIRE_DRIFT_ values), the kernel does the actual write.
+struct ClassicSpread {
+    template<typename Cell>
+    static void apply(const Cell value, const unsigned int rnd, Cell &heat, Cell &drift) {
+        // Plain arithmetic rather than branches, so the compute pass vectorizes.
+        const unsigned int lit = value != 0;
+        heat = (Cell) (value - ((rnd & 1u) & lit));
+        drift = (Cell) (lit ? rnd : FIRE_DRIFT_UP);
+    }
+};
+
+// Runs one tick over a grid of `width` * `height` cells. FixedWidth is the grid width when known at compile time, or 0
+// to use `width`. BlockAligned promises that the width is a multiple of FIRE_BLOCK, which removes the partial block at
+// the end of each row.
+//
+// Each row goes through three passes:
+//  1) Random bytes, one xorshift call per block. Inherently sequential, but only one call per 8 cells.
+//  2) New heat and drift for every cell.
+//  3) Writing the heat into the row above. Written naively this is a scatter to data dependent addresses, which can't
+//     be vectorized. But heat only ever drifts by -1, 0 or +1, so each destination has just three possible sources, and
+//     when several land on the same cell the rightmost one wins (it was written last). So instead every destination
+//     picks its value from its three neighbours, which is a plain stencil.
+// Passes 2 and 3 are straight line code over arrays and vectorize. Only the two writes which fall outside the row
+// (leftmost cell drifting left, rightmost drifting right) are done separately.
+template<typename Cell, size_t FixedWidth, bool BlockAligned, typename Policy>
+void spreadFireKernel(void *grid, const size_t runtime_width, const size_t height, FireRng &rng) {
+    static_assert(FixedWidth == 0 || !BlockAligned || FixedWidth % FIRE_BLOCK == 0,
+                  "a block aligned kernel needs a block aligned width");
+
+    Cell *cells = static_cast<Cell *>(grid);
+    const size_t width = FixedWidth ? FixedWidth : runtime_width;
+    const size_t blocks = BlockAligned ? width / FIRE_BLOCK : (width + FIRE_BLOCK - 1) / FIRE_BLOCK;
+
+    // Scratch space for one row, kept between ticks. heat and drift have an extra entry on either side, drifting up so
+    // that they never look like a source for the cells at the ends of the row.
+    static thread_local std::vector<uint8_t> random;
+    static thread_local std::vector<Cell> heat_buffer;
+    static thread_local std::vector<Cell> drift_buffer;
+    random.resize(blocks * FIRE_BLOCK);
+    heat_buffer.assign(width + 2, 0);
+    drift_buffer.assign(width + 2, FIRE_DRIFT_UP);
+    // Plain pointers, since stores through the (char sized) cells could otherwise alias the vectors' own pointers.
+    uint8_t *random_bytes = random.data();
+    Cell *heat = heat_buffer.data() + 1;
+    Cell *drift = drift_buffer.data() + 1;
+
+    // Every cell writes into the row above it, so starting at row 1 keeps us from writing above the top of the grid.
+    // Rows are only ever written after they've been read this tick, so the passes can't see each other's writes.
+    for (size_t y = 1; y < height; y++) {
+        const Cell *src = cells + y * width;
+        Cell *dst = cells + (y - 1) * width;
+
+        for (size_t block = 0; block < blocks; block++) {
+            const uint64_t bits = rng.next();
+            for (size_t lane = 0; lane < FIRE_BLOCK; lane++) {
+                random_bytes[block * FIRE_BLOCK + lane] = (uint8_t) (bits >> (lane * 8u));
+            }
+        }
+
+        for (size_t x = 0; x < width; x++) {
+            // Scales a random byte into 0, 1 or 2.
+            const auto rnd = (unsigned int) ((random_bytes[x] * 3u) >> 8u);
+            Policy::apply(src[x], rnd, heat[x], drift[x]);
+        }
+
+        // Out of the three cells that may land on x, the one furthest right wins. Nothing landing leaves it as it was.
+        // The choice is made with masks rather than branches, since which way the heat drifts is random.
+        for (size_t x = 0; x < width; x++) {
+            const auto from_left = (Cell) -(Cell) (drift[x - 1] == FIRE_DRIFT_RIGHT);
+            const auto from_below = (Cell) -(Cell) (drift[x] == FIRE_DRIFT_UP);
+            const auto from_right = (Cell) -(Cell) (drift[x + 1] == FIRE_DRIFT_LEFT);
+
+            Cell value = dst[x];
+            value = (Cell) ((value & ~from_left) | (heat[x - 1] & from_left));
+            value = (Cell) ((value & ~from_below) | (heat[x] & from_below));
+            value = (Cell) ((value & ~from_right) | (heat[x + 1] & from_right));
+            dst[x] = value;
+        }
+
+        // The leftmost cell can drift into the end of the row before (or the padding), the rightmost into the start of
+        // the row it came from, which has already been read.
+        if (drift[0] == FIRE_DRIFT_LEFT) dst[-1] = heat[0];
+        if (drift[width - 1] == FIRE_DRIFT_RIGHT) dst[width] = heat[width - 1];
+    }
+}
+
+typedef void (*SpreadFireKernel)(void *grid, size_t width, size_t height, FireRng &rng);
+
+// The smallest cell size in bytes which fits every index of a palette of the given size.
+size_t fireCellSize(size_t palette_size);
+
+// Picks the most specialized kernel for the given configuration, falling back to a generic one.
+SpreadFireKernel selectSpreadFireKernel(size_t palette_size, size_t width);
+
+#endif //DOOMFIRE_FIREKERNELS_H
@@ -41,28 +41,31 @@ std::vector<sf::Color> ColorUtils::expandPalette(
     std::vector<sf::Color> new_palette;
 
     double step_size = (double) old_palette.size() / new_length;
-    double step = 0;
 
-    while (step < (double) new_length - 1) {
+    // Always produces exactly new_length colors, so every palette index the simulation can hold has a color.
+    for (size_t i = 0; i < new_length; i++) {
+        const double step = i * step_size;
+
         // First convert actual index into an index relative to our classic palette
         auto intermediate_scale = ((double) step / new_length) * (double) old_palette.size();
 
         // This is the current index of the old_palette.
         const size_t scaled_idx = floor(intermediate_scale);
 
+        // Past the last pair of colors there's nothing left to blend towards.
+        if (scaled_idx + 1 >= old_palette.size()) {
+            new_palette.push_back(old_palette.back());
+            continue;
+        }
+
         // This can be viewed as:
         //      How far away from the first value towards the second value we are expressed as a percentage.
         auto scaled_fraction = intermediate_scale - scaled_idx;
 
         auto c0 = old_palette[scaled_idx];
-
-        // This lookup seems to be causing a warning in valgrind:
-        //      `Invalid reading of size 4`
         auto c1 = old_palette[scaled_idx + 1];
 
         new_palette.push_back(lerpColor(c0, c1, scaled_fraction, use_hsv, _interpolation_function));
-
-        step += step_size;
     }
 
     return new_palette;
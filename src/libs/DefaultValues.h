@@ -6,6 +6,7 @@
 #define DOOMFIRE_DEFAULTVALUES_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <vector>
 #include <chrono>
@@ -31,6 +32,9 @@ constexpr static unsigned int DEFAULT_HEIGHT = 240;
 // screen size.
 constexpr static unsigned int DEFAULT_WIDTH = (size_t) (DEFAULT_HEIGHT * (16.0 / 9.0));
 
+// DEFAULT_SEED: Starting state of the simulation's random number generator. Any value except 0 works.
+constexpr static uint64_t DEFAULT_SEED = 0x9E3779B97F4A7C15ULL;
+
 // DEFAULT_INTERPOLATION_FUNCTION:
 // TODO: describe
 const static auto DEFAULT_INTERPOLATION_FUNCTION = InterpolationFunction::Cosine;
@@ -0,0 +1,31 @@
+#include <cerrno>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "FileUtils.h"
+
+// Creates a single directory. Returns true if it was created or something by that name already exists, which is as
+// close as we can get without platform specific ways of telling directories from files. Anything wrong with it shows
+// up as soon as we try to write into it.
+bool FileUtils::makeDirectory(const std::string &path) {
+#ifdef _WIN32
+    const int result = _mkdir(path.c_str());
+#else
+    const int result = mkdir(path.c_str(), 0755);
+#endif
+
+    return result == 0 || errno == EEXIST;
+}
+
+// Creates a directory and any missing parents.
+bool FileUtils::makeDirectories(const std::string &path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        makeDirectory(path.substr(0, slash));
+    }
+
+    return makeDirectory(path);
+}
@@ -0,0 +1,16 @@
+#ifndef DOOMFIRE_FILEUTILS_H
+#define DOOMFIRE_FILEUTILS_H
+
+#include <string>
+
+// Small filesystem helpers which work the same on POSIX systems and Windows.
+class FileUtils {
+
+public:
+    static bool makeDirectory(const std::string &path);
+
+    static bool makeDirectories(const std::string &path);
+};
+
+
+#endif //DOOMFIRE_FILEUTILS_H
@@ -0,0 +1,20 @@
+#ifndef DOOMFIRE_OPTIONS_H
+#define DOOMFIRE_OPTIONS_H
+
+// Backend: Where the fire is drawn.
+namespace Backend {
+    enum Backend {
+        SFML,
+        TTY
+    };
+}
+
+// ImageFormat: File formats the image sequence exporter can write.
+namespace ImageFormat {
+    enum ImageFormat {
+        PNG,
+        PPM
+    };
+}
+
+#endif //DOOMFIRE_OPTIONS_H
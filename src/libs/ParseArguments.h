@@ -7,19 +7,38 @@
 
 #include <args.hxx>
 #include "DefaultValues.h"
+#include "Options.h"
 
 struct parameters {
     unsigned int height = 0;
     unsigned int width = 0;
 
     unsigned int palette_size = 0;
+    // No --palette_size was given, so the palette is sized after the fire's height.
+    bool auto_palette_size = false;
 
     bool capped = false;
     unsigned int fps = 30;
     bool hsv = false;
 
+    uint64_t seed = DEFAULT_SEED;
+    bool warm_start = true;
+    std::string snapshot_dir;
+
     InterpolationFunction::InterpolationFunction interpolation_function = DEFAULT_INTERPOLATION_FUNCTION;
 
+    Backend::Backend backend = Backend::SFML;
+
+    std::string shm_name;
+    unsigned int shm_slots = 3;
+
+    std::string control_path;
+
+    std::string export_dir;
+    unsigned int frames = 0;
+    ImageFormat::ImageFormat export_format = ImageFormat::PNG;
+    unsigned int export_threads = 0;
+
     args::Error *error = nullptr;
     std::string error_message;
 };
@@ -31,6 +50,18 @@ static auto parseInterpolationFunction(const std::string &interpolation_function
     return DEFAULT_INTERPOLATION_FUNCTION;
 }
 
+static auto parseBackend(const std::string &backend) {
+    if (backend == "tty") return Backend::TTY;
+
+    return Backend::SFML;
+}
+
+static auto parseImageFormat(const std::string &format) {
+    if (format == "ppm") return ImageFormat::PPM;
+
+    return ImageFormat::PNG;
+}
+
 static parameters parseArguments(int argc, char **argv) {
     auto params = parameters();
 
@@ -73,24 +104,95 @@ static parameters parseArguments(int argc, char **argv) {
     args::ValueFlag<unsigned int> fps(
             parser,
             "fps",
-            "Sets max FPS. Accepts an integer.",
+            "Sets max FPS. Accepts an integer, 0 means uncapped.",
             {'f', "fps"}, 30);
     args::Flag hsv(
             parser,
             "hsv",
             "Toggles interpolating in the HSV colorspace. Takes no arguments.",
             {"hsv"}, false);
+    args::ValueFlag<uint64_t> seed(
+            parser,
+            "seed",
+            "Seed of the simulation's random number generator. Accepts an integer.",
+            {"seed"}, DEFAULT_SEED);
+    args::Flag cold_start(
+            parser,
+            "cold_start",
+            "Starts from a black screen instead of a cached, already burning snapshot. Takes no arguments.",
+            {"cold_start"}, false);
+    args::ValueFlag<std::string> snapshot_dir(
+            parser,
+            "snapshot_dir",
+            "Where warm start snapshots are cached. Defaults to $XDG_CACHE_HOME/doomfire or ~/.cache/doomfire.",
+            {"snapshot_dir"}, "");
+    args::ValueFlag<std::string> backend(
+            parser,
+            "backend",
+            "Where to draw the fire. Currently supports `sfml` (a window) or `tty` (truecolor ANSI in the terminal)",
+            {'b', "backend"}, "sfml");
+    args::ValueFlag<std::string> shm_name(
+            parser,
+            "shm",
+            "Also publishes every frame into a POSIX shared memory ring with this name.",
+            {"shm"}, "");
+    args::ValueFlag<unsigned int> shm_slots(
+            parser,
+            "shm_slots",
+            "Number of frames kept in the shared memory ring. Accepts an integer.",
+            {"shm_slots"}, 3);
+    args::ValueFlag<std::string> control_path(
+            parser,
+            "control",
+            "Listens on a Unix domain socket at this path for live changes, e.g. `set palette_size 80`, `set fps 35`, "
+            "`set hsv on`, `set interpolation Cosine`, `set size 640 360`, `pause`, `resume` or `stats`.",
+            {"control"}, "");
+
+    // Export options
+    args::ValueFlag<std::string> export_dir(
+            parser,
+            "export_dir",
+            "Renders --frames frames without a window and writes them as numbered images into this directory.",
+            {"export_dir"}, "");
+    args::ValueFlag<unsigned int> frames(
+            parser,
+            "frames",
+            "Number of frames to export. Accepts an integer.",
+            {"frames"}, 300);
+    args::ValueFlag<std::string> export_format(
+            parser,
+            "export_format",
+            "Image format of exported frames. Currently supports `png` or `ppm`",
+            {"export_format"}, "png");
+    args::ValueFlag<unsigned int> export_threads(
+            parser,
+            "export_threads",
+            "Number of threads encoding exported frames. Defaults to one per core.",
+            {"export_threads"}, 0);
     try {
         parser.ParseCLI(argc, argv);
 
         params.height = height.Get();
         params.width = width.Get();
         params.palette_size = palette_size.Get();
-        params.capped = !uncapped.Get();
+        params.auto_palette_size = params.palette_size == 0;
         params.fps = fps.Get();
+        // A cap of 0 means no cap, same as `set fps 0` on the control socket.
+        params.capped = !uncapped.Get() && params.fps != 0;
         params.hsv = hsv.Get();
+        params.seed = seed.Get();
+        params.warm_start = !cold_start.Get();
+        params.snapshot_dir = snapshot_dir.Get();
 
         params.interpolation_function = parseInterpolationFunction(interpolation_function.Get());
+        params.backend = parseBackend(backend.Get());
+        params.shm_name = shm_name.Get();
+        params.shm_slots = shm_slots.Get();
+        params.control_path = control_path.Get();
+        params.export_dir = export_dir.Get();
+        params.frames = frames.Get();
+        params.export_format = parseImageFormat(export_format.Get());
+        params.export_threads = export_threads.Get();
 
     }
     catch (args::Help &h) {
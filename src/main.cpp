@@ -1,10 +1,48 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef DOOMFIRE_POSIX
+#include <unistd.h>
+#endif
 
 #include <SFML/Graphics.hpp>
 
 #include "main.h"
+#include "libs/FileUtils.h"
 #include "libs/ParseArguments.h"
 #include "effects/DoomFire.h"
+#include "sinks/ImageSequenceExporter.h"
+
+#ifdef DOOMFIRE_POSIX
+#include "control/ControlSocket.h"
+#include "renderers/TerminalRenderer.h"
+#include "sinks/SharedMemorySink.h"
+#else
+// Only ever passed around as null pointers where the control socket and shared memory aren't available.
+class ControlSocket;
+class SharedMemorySink;
+#endif
+
+// Set from our signal handlers. The terminal backend has no window to close, so it watches these instead.
+static volatile sig_atomic_t quit_requested = 0;
+
+void handle_quit_signal(int) {
+    quit_requested = 1;
+}
+
+#ifdef DOOMFIRE_POSIX
+static volatile sig_atomic_t terminal_resized = 0;
+
+void handle_resize_signal(int) {
+    terminal_resized = 1;
+}
+#endif
 
 // Handles window events. SFML handles events internally, and asynchronously. Events will accumulate until pollEvent is
 // called which will load the next event into our `event` object which we can use to handle events such as resizing the
@@ -39,37 +77,304 @@ init_drawing(const unsigned int w, const unsigned int h, DoomFire &df, sf::Image
     rect.setPosition(0, 0);
 }
 
-// Our entry point
-int main(int argc, char **argv) {
-    // Parse cli arguments
-    auto params = parseArguments(argc, argv);
+// Where warm start snapshots live unless --snapshot_dir says otherwise. Empty if we have nowhere to put them.
+std::string default_snapshot_dir() {
+    const char *cache_home = std::getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home) return std::string(cache_home) + "/doomfire";
 
-    if (typeid(params.error) == typeid(args::Help)) {
-        std::cout << params.error_message;
-        return 0;
-    } else if (params.error != nullptr) {
-        std::cerr << params.error_message;
-        return 1;
+    const char *home = std::getenv("HOME");
+    if (home && *home) return std::string(home) + "/.cache/doomfire";
+
+    const char *local_app_data = std::getenv("LOCALAPPDATA");
+    if (local_app_data && *local_app_data) return std::string(local_app_data) + "/doomfire";
+
+    return "";
+}
+
+// Gets a freshly (re)initialized fire straight to burning. Snapshots of a burning fire are cached per width, height,
+// palette size and seed: if one exists it's loaded, otherwise we fast forward the simulation until the flames have
+// reached their full height, without drawing, and cache the result for next time. Sizes we only pass through, like the
+// ones a terminal goes through while its window is dragged, aren't cached, or the cache would grow without bound.
+void warm_start(DoomFire &doom_fire, const parameters &params, bool cache = true) {
+    if (!params.warm_start) return;
+
+    const std::string dir = params.snapshot_dir.empty() ? default_snapshot_dir() : params.snapshot_dir;
+
+    std::stringstream path;
+    path << dir << "/" << doom_fire.getWidth() << "x" << doom_fire.getHeight()
+         << "_p" << doom_fire.getPaletteSize() << "_s" << std::hex << doom_fire.getSeed() << ".snapshot";
+
+    if (!dir.empty() && doom_fire.loadSnapshot(path.str())) return;
+
+    // Flames climb at most one row per tick, twice the height leaves them time to settle once they get there.
+    doom_fire.fastForward(doom_fire.getHeight() * 2);
+
+    // Failing to cache only costs us the fast forward next time.
+    if (cache && !dir.empty() && FileUtils::makeDirectories(dir)) doom_fire.saveSnapshot(path.str());
+}
+
+// The palette size that keeps the flames of a fire this tall on screen, when none was asked for.
+unsigned int fitting_palette_size(unsigned int height) {
+    const double palette_size_ratio = (double) DEFAULT_PALETTE_SIZE / DEFAULT_HEIGHT;
+    return std::max(2u, (unsigned int) floor(height * palette_size_ratio));
+}
+
+#ifdef DOOMFIRE_POSIX
+// Shrinks the requested simulation size so that it fits in the terminal. Each character cell shows two pixels stacked
+// vertically, so the terminal fits twice as many rows of pixels as it has lines.
+void fit_to_terminal(unsigned int &w, unsigned int &h) {
+    unsigned int cols, rows;
+    if (!TerminalRenderer::querySize(STDOUT_FILENO, cols, rows)) return;
+
+    if (w > cols) w = cols;
+    if (h > rows * 2) h = rows * 2;
+}
+#endif
+
+// State of a running backend which the control socket can inspect and change.
+struct RunState {
+    bool paused = false;
+    uint64_t ticks = 0;
+    double measured_fps = 0;
+    bool publish_failing = false;
+    std::chrono::steady_clock::time_point last_tick = std::chrono::steady_clock::now();
+};
+
+// What a batch of control commands changed, so the backend knows what it has to redo.
+struct ControlChanges {
+    bool palette = false;
+    bool size = false;
+    bool fps = false;
+};
+
+// Publishes the current frame to shared memory, if we're doing that. Failures are reported when they start rather than
+// on every tick.
+void publish_frame(SharedMemorySink *shm_sink, const DoomFire &doom_fire, RunState &state) {
+#ifdef DOOMFIRE_POSIX
+    if (shm_sink == nullptr) return;
+
+    const bool published = shm_sink->publish(doom_fire);
+    if (!published && !state.publish_failing) std::cerr << "shared memory: " << shm_sink->getError() << std::endl;
+    state.publish_failing = !published;
+#else
+    (void) shm_sink;
+    (void) doom_fire;
+    (void) state;
+#endif
+}
+
+// Whether frames of this size can be published. Readers map the shared memory ring once, so it can't grow along with
+// the fire. Always true if we aren't publishing.
+bool fits_shared_memory(const SharedMemorySink *shm_sink, const unsigned int w, const unsigned int h) {
+#ifdef DOOMFIRE_POSIX
+    return shm_sink == nullptr || shm_sink->fits(w, h);
+#else
+    (void) shm_sink;
+    (void) w;
+    (void) h;
+    return true;
+#endif
+}
+
+// Largest values the control socket accepts. Palette indices have to fit the 16 bit indices published over shared
+// memory, and anything much bigger than a 16K screen is far more likely a typo than a fire anyone wants.
+static const unsigned long MAX_CONTROL_PALETTE_SIZE = 65536;
+static const unsigned long MAX_CONTROL_SIZE = 16384;
+static const unsigned long MAX_CONTROL_FPS = 1000;
+
+// Applies a new simulation size for a backend. Returns an error message (leaving the old size in place) if the backend
+// can't show that size, or an empty string once it has been applied.
+typedef std::function<std::string()> ApplySize;
+
+// Counts a tick and keeps a smoothed measurement of how many we manage per second.
+void count_tick(RunState &state) {
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - state.last_tick).count();
+    state.last_tick = now;
+    state.ticks++;
+
+    if (seconds > 0) state.measured_fps = state.measured_fps * 0.9 + (1.0 / seconds) * 0.1;
+}
+
+// Parses a number sent over the control socket. Unlike plain std::stoul this refuses signs (stoul happily turns "-1"
+// into ULONG_MAX), trailing junk and anything larger than max.
+bool parse_control_number(const std::string &text, const unsigned long max, unsigned long &number) {
+    if (text.empty() || text.size() > 10 || text.find_first_not_of("0123456789") != std::string::npos) return false;
+
+    number = std::stoul(text);
+    return number <= max;
+}
+
+// Applies a single control command. Returns the reply for the client.
+std::string apply_command(const std::vector<std::string> &words, parameters &params, DoomFire &doom_fire,
+                          RunState &state, ControlChanges &changes) {
+    const std::string &verb = words[0];
+
+    if (verb == "pause" && words.size() == 1) {
+        state.paused = true;
+        return "ok";
+    } else if (verb == "resume" && words.size() == 1) {
+        state.paused = false;
+        return "ok";
+    } else if (verb == "stats" && words.size() == 1) {
+        std::stringstream stats;
+        stats << "ticks " << state.ticks
+              << " fps " << (int) state.measured_fps
+              << " fps_cap " << (params.capped ? params.fps : 0)
+              << " width " << doom_fire.getWidth()
+              << " height " << doom_fire.getHeight()
+              << " palette_size " << doom_fire.getPaletteSize()
+              << " hsv " << (doom_fire.getHsv() ? "on" : "off")
+              << " interpolation " << (doom_fire.getInterpolation() == InterpolationFunction::Cosine ? "Cosine" : "Linear")
+              << " paused " << (state.paused ? "yes" : "no");
+        return stats.str();
+    } else if (verb != "set" || words.size() < 3) {
+        return "error: unknown command";
     }
 
-    // Our actual code below
-    sf::Image fire_image; // Construct Image to write pixels onto.
-    sf::Texture fire_texture; // Constructs Texture onto which we can draw our Image.
-    sf::RectangleShape screen_rect; // Constructs a rectangle which takes our texture and can be used to draw to our window.
+    const std::string &name = words[1];
+    const std::string &value = words[2];
+
+    if (name == "palette_size" && words.size() == 3) {
+        unsigned long palette_size;
+        if (!parse_control_number(value, MAX_CONTROL_PALETTE_SIZE, palette_size) || palette_size < 2)
+            return "error: palette_size must be between 2 and " + std::to_string(MAX_CONTROL_PALETTE_SIZE);
 
-    if (params.palette_size == 0) {
-        const double palette_size_ratio = (double) DEFAULT_PALETTE_SIZE / DEFAULT_HEIGHT;
-        params.palette_size = floor(params.height * palette_size_ratio);
+        params.palette_size = (unsigned int) palette_size;
+        params.auto_palette_size = false;
+        changes.palette = true;
+    } else if (name == "hsv" && words.size() == 3 && (value == "on" || value == "off")) {
+        params.hsv = value == "on";
+        changes.palette = true;
+    } else if (name == "interpolation" && words.size() == 3 && (value == "Linear" || value == "Cosine")) {
+        params.interpolation_function = parseInterpolationFunction(value);
+        changes.palette = true;
+    } else if (name == "fps" && words.size() == 3) {
+        // 0 lifts the cap, like --uncapped.
+        unsigned long fps;
+        if (!parse_control_number(value, MAX_CONTROL_FPS, fps))
+            return "error: fps must be between 0 and " + std::to_string(MAX_CONTROL_FPS);
+
+        params.fps = (unsigned int) fps;
+        params.capped = params.fps != 0;
+        changes.fps = true;
+    } else if (name == "size" && words.size() == 4) {
+        unsigned long w, h;
+        const bool valid = parse_control_number(words[2], MAX_CONTROL_SIZE, w) &&
+                           parse_control_number(words[3], MAX_CONTROL_SIZE, h);
+        if (!valid || w == 0 || h < 2)
+            return "error: size must be between 1x2 and " + std::to_string(MAX_CONTROL_SIZE) + "x" +
+                   std::to_string(MAX_CONTROL_SIZE);
+
+        params.width = (unsigned int) w;
+        params.height = (unsigned int) h;
+        changes.size = true;
+    } else {
+        return "error: unknown setting or bad value";
     }
 
-    // Initialize the fire sim
-    DoomFire doom_fire(
-            params.width,
-            params.height,
-            params.palette_size,
-            params.hsv,
-            params.interpolation_function
-    ); // Custom virtual palette size
+    return "ok";
+}
+
+#ifdef DOOMFIRE_POSIX
+// Applies everything that arrived on the control socket since the last tick. A change that fails (say we run out of
+// memory building a huge palette) is rolled back, and the commands which asked for it are answered with the error
+// instead of "ok".
+ControlChanges handle_control_commands(ControlSocket *control, parameters &params, DoomFire &doom_fire,
+                                       RunState &state, const SharedMemorySink *shm_sink, const ApplySize &apply_size) {
+    ControlChanges changes;
+    if (control == nullptr) return changes;
+
+    std::vector<ControlCommand> commands;
+    control->poll(commands);
+    if (commands.empty()) return changes;
+
+    struct Reply {
+        int client;
+        std::string message;
+        ControlChanges changes;
+    };
+    std::vector<Reply> replies;
+
+    const unsigned int old_width = params.width;
+    const unsigned int old_height = params.height;
+
+    for (const auto &command : commands) {
+        Reply reply{command.client, std::string(), ControlChanges()};
+        try {
+            reply.message = apply_command(command.words, params, doom_fire, state, reply.changes);
+        } catch (std::exception &) {
+            reply.message = "error: bad number";
+        }
+
+        changes.palette = changes.palette || reply.changes.palette;
+        changes.size = changes.size || reply.changes.size;
+        changes.fps = changes.fps || reply.changes.fps;
+        replies.push_back(std::move(reply));
+    }
+
+    // Settings are collected first and applied once, so a burst of commands costs at most one palette rebuild.
+    std::string palette_error;
+    if (changes.palette) {
+        try {
+            doom_fire.setPalette(params.palette_size, params.hsv, params.interpolation_function);
+        } catch (std::exception &e) {
+            palette_error = std::string("error: couldn't change the palette: ") + e.what();
+
+            // setPalette leaves the fire as it was when it throws.
+            params.palette_size = (unsigned int) doom_fire.getPaletteSize();
+            params.hsv = doom_fire.getHsv();
+            params.interpolation_function = doom_fire.getInterpolation();
+            changes.palette = false;
+        }
+    }
+
+    std::string size_error;
+    if (changes.size) {
+        try {
+            if (!fits_shared_memory(shm_sink, params.width, params.height))
+                size_error = "error: size is larger than the shared memory frames, which are sized at startup";
+            else
+                size_error = apply_size();
+        } catch (std::exception &e) {
+            size_error = std::string("error: couldn't change the size: ") + e.what();
+
+            // The backend may have gotten halfway, so the old size is applied again. It fit before, so if it doesn't
+            // now there is nothing sensible left to do.
+            params.width = old_width;
+            params.height = old_height;
+            apply_size();
+        }
+
+        if (!size_error.empty()) {
+            params.width = old_width;
+            params.height = old_height;
+            changes.size = false;
+        }
+    }
+
+    for (auto &reply : replies) {
+        if (reply.changes.palette && !palette_error.empty()) reply.message = palette_error;
+        if (reply.changes.size && !size_error.empty()) reply.message = size_error;
+
+        control->reply(reply.client, reply.message);
+    }
+
+    return changes;
+}
+#else
+// Without the control socket there's never anything to apply.
+ControlChanges handle_control_commands(ControlSocket *, parameters &, DoomFire &, RunState &, const SharedMemorySink *,
+                                       const ApplySize &) {
+    return ControlChanges();
+}
+#endif
+
+// Runs the simulation in an SFML window until the window is closed.
+int run_sfml(parameters params, DoomFire &doom_fire, SharedMemorySink *shm_sink, ControlSocket *control) {
+    sf::Image fire_image; // Construct Image to write pixels onto.
+    sf::Texture fire_texture; // Constructs Texture onto which we can draw our Image.
+    sf::RectangleShape screen_rect; // Constructs a rectangle which takes our texture and can be used to draw to our window.
 
     // Creates our actual window with our dimensions and a window title.
     sf::RenderWindow window(sf::VideoMode(params.width, params.height), "DoomFire");
@@ -77,15 +382,37 @@ int main(int argc, char **argv) {
 
     // Initializes our drawing surfaces and simulation
     init_drawing(params.width, params.height, doom_fire, fire_image, fire_texture, screen_rect);
+    warm_start(doom_fire, params);
 
     sf::Event event{}; // used to hold data about triggered events. SFML example code had this as a global.
+    RunState state;
+
+    const ApplySize apply_size = [&]() -> std::string {
+        const unsigned int max_size = sf::Texture::getMaximumSize();
+        if (params.width > max_size || params.height > max_size)
+            return "error: size is larger than this GPU's biggest texture (" + std::to_string(max_size) + ")";
+
+        window.setSize(sf::Vector2u(params.width, params.height));
+        window.setView(sf::View(sf::FloatRect(0, 0, (float) params.width, (float) params.height)));
+        init_drawing(params.width, params.height, doom_fire, fire_image, fire_texture, screen_rect);
+        warm_start(doom_fire, params);
+        return "";
+    };
 
     // Here's our main loop. It runs as long as the window is open.
     while (window.isOpen()) {
         handle_window_events(window, event);
 
+        // Applies live changes between ticks.
+        const ControlChanges changes = handle_control_commands(control, params, doom_fire, state, shm_sink, apply_size);
+        if (changes.fps) window.setFramerateLimit(params.capped ? params.fps : 0);
+
         // Runs one iteration of our fire simulation.
-        doom_fire.doFire();
+        if (!state.paused) {
+            doom_fire.doFire();
+            publish_frame(shm_sink, doom_fire, state);
+        }
+        count_tick(state);
 
         // Calls our drawing code above to load the pixel data into the texture
         drawFire(doom_fire, fire_image, fire_texture, screen_rect);
@@ -99,6 +426,191 @@ int main(int argc, char **argv) {
         window.display();
     }
 
-    // Returns success if we closed the program and didn't crash.
     return EXIT_SUCCESS;
 }
+
+#ifdef DOOMFIRE_POSIX
+// Runs the simulation in the terminal until we receive SIGINT or SIGTERM.
+int run_tty(parameters params, DoomFire &doom_fire, SharedMemorySink *shm_sink, ControlSocket *control) {
+    std::signal(SIGINT, handle_quit_signal);
+    std::signal(SIGTERM, handle_quit_signal);
+    std::signal(SIGWINCH, handle_resize_signal);
+
+    TerminalRenderer renderer(STDOUT_FILENO);
+    renderer.begin();
+
+    auto next_tick = std::chrono::steady_clock::now();
+    RunState state;
+
+    // The renderer notices the new geometry on its own and repaints everything. A palette sized after the fire's
+    // height follows the fitted height, before the warm start so that the right snapshot is picked.
+    const auto fit_fire = [&](bool cache) {
+        unsigned int w = params.width;
+        unsigned int h = params.height;
+        fit_to_terminal(w, h);
+        if (w != doom_fire.getWidth() || h != doom_fire.getHeight()) {
+            doom_fire.resize(w, h);
+            if (params.auto_palette_size && fitting_palette_size(h) != doom_fire.getPaletteSize()) {
+                doom_fire.setPalette(fitting_palette_size(h), params.hsv, params.interpolation_function);
+                params.palette_size = (unsigned int) doom_fire.getPaletteSize();
+            }
+            warm_start(doom_fire, params, cache);
+        }
+    };
+
+    // Sizes asked for over the control socket are worth caching, the ones we pass through while resizing aren't.
+    const ApplySize apply_size = [&]() -> std::string {
+        fit_fire(true);
+        return "";
+    };
+
+    while (!quit_requested) {
+        const ControlChanges changes = handle_control_commands(control, params, doom_fire, state, shm_sink, apply_size);
+
+        // Same colors under different indices, so the renderer can't tell what changed.
+        if (changes.palette) renderer.invalidate();
+
+        // Even if the fire keeps its size, the terminal may have reflowed what it showed or left old cells around it.
+        if (terminal_resized) {
+            terminal_resized = 0;
+            fit_fire(false);
+            renderer.invalidate();
+        }
+
+        if (!state.paused) {
+            doom_fire.doFire();
+            publish_frame(shm_sink, doom_fire, state);
+        }
+        count_tick(state);
+        renderer.draw(doom_fire);
+
+        if (params.capped && params.fps != 0) {
+            // If we fell behind (e.g. a slow link) we don't try to catch up, we just start pacing from now.
+            const auto tick_length = std::chrono::microseconds(1000000 / params.fps);
+            const auto now = std::chrono::steady_clock::now();
+            next_tick = std::max(next_tick + tick_length, now);
+            std::this_thread::sleep_until(next_tick);
+        }
+    }
+
+    renderer.end();
+
+    return EXIT_SUCCESS;
+}
+#endif
+
+// Runs the simulation without a window as fast as the encoders can keep up and writes every frame to disk.
+int run_export(const parameters &params, DoomFire &doom_fire) {
+    size_t encoder_threads = params.export_threads;
+    if (encoder_threads == 0) encoder_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // A couple of frames per encoder is enough to keep them all busy.
+    ImageSequenceExporter exporter(params.export_dir, params.export_format, encoder_threads, encoder_threads * 2);
+    if (!exporter.start(doom_fire.getPalette())) {
+        std::cerr << exporter.getError() << std::endl;
+        return 1;
+    }
+
+    for (size_t frame = 0; frame < params.frames; frame++) {
+        doom_fire.doFire();
+        if (!exporter.push(doom_fire)) break;
+    }
+
+    if (!exporter.finish()) {
+        std::cerr << exporter.getError() << std::endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Our entry point
+int main(int argc, char **argv) {
+    // Parse cli arguments
+    auto params = parseArguments(argc, argv);
+
+    if (typeid(params.error) == typeid(args::Help)) {
+        std::cout << params.error_message;
+        return 0;
+    } else if (params.error != nullptr) {
+        std::cerr << params.error_message;
+        return 1;
+    }
+
+    // The terminal backend can't draw more pixels than the terminal has room for. params keeps the requested size, so
+    // the fire can grow back to it when the terminal gets bigger. Offline export never reaches a backend, so it keeps
+    // the requested size.
+    const bool run_tty_backend = params.backend == Backend::TTY && params.export_dir.empty();
+    unsigned int fire_width = params.width;
+    unsigned int fire_height = params.height;
+#ifdef DOOMFIRE_POSIX
+    if (run_tty_backend) fit_to_terminal(fire_width, fire_height);
+#else
+    if (run_tty_backend) {
+        std::cerr << "The tty backend is only available on POSIX systems" << std::endl;
+        return 1;
+    }
+#endif
+
+    if (params.auto_palette_size) params.palette_size = fitting_palette_size(fire_height);
+
+    // Initialize the fire sim
+    DoomFire doom_fire(
+            fire_width,
+            fire_height,
+            params.palette_size,
+            params.hsv,
+            params.interpolation_function,
+            params.seed
+    ); // Custom virtual palette size
+
+    // Offline export replaces the interactive backends entirely. The SFML backend has to warm start itself, since
+    // setting up its drawing surfaces resets the fire.
+    if (params.backend != Backend::SFML || !params.export_dir.empty()) warm_start(doom_fire, params);
+    if (!params.export_dir.empty()) return run_export(params, doom_fire);
+
+    // Optionally share our frames with other processes. The slots are sized for the requested size, and the control
+    // socket refuses to make the fire any bigger than that.
+#ifdef DOOMFIRE_POSIX
+    SharedMemorySink shm_sink;
+    if (!params.shm_name.empty() &&
+        !shm_sink.open(params.shm_name, params.width, params.height, params.shm_slots)) {
+        std::cerr << shm_sink.getError() << std::endl;
+        return 1;
+    }
+    SharedMemorySink *shm_sink_ptr = params.shm_name.empty() ? nullptr : &shm_sink;
+#else
+    if (!params.shm_name.empty()) {
+        std::cerr << "--shm is only available on POSIX systems" << std::endl;
+        return 1;
+    }
+    SharedMemorySink *shm_sink_ptr = nullptr;
+#endif
+
+    // Optionally accept live changes over a local socket.
+#ifdef DOOMFIRE_POSIX
+    ControlSocket control;
+    if (!params.control_path.empty() && !control.open(params.control_path)) {
+        std::cerr << control.getError() << std::endl;
+        return 1;
+    }
+    ControlSocket *control_ptr = control.isOpen() ? &control : nullptr;
+#else
+    if (!params.control_path.empty()) {
+        std::cerr << "--control is only available on POSIX systems" << std::endl;
+        return 1;
+    }
+    ControlSocket *control_ptr = nullptr;
+#endif
+
+    // Hands off to the chosen backend, which returns success if we closed the program and didn't crash.
+    switch (params.backend) {
+#ifdef DOOMFIRE_POSIX
+        case Backend::TTY:
+            return run_tty(params, doom_fire, shm_sink_ptr, control_ptr);
+#endif
+        case Backend::SFML:
+        default:
+            return run_sfml(params, doom_fire, shm_sink_ptr, control_ptr);
+    }
+}
@@ -0,0 +1,193 @@
+#include <cerrno>
+#include <limits>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "TerminalRenderer.h"
+
+// Marks a screen cell whose contents we don't know, which forces it to be redrawn.
+static const uint64_t UNKNOWN_CELL = std::numeric_limits<uint64_t>::max();
+
+// The upper half block, encoded as UTF-8.
+static const char HALF_BLOCK[] = "\xE2\x96\x80";
+
+TerminalRenderer::TerminalRenderer(const int fd) {
+    _fd = fd;
+}
+
+// Asks the terminal behind fd how many character cells it has. Returns false if fd isn't a terminal.
+bool TerminalRenderer::querySize(const int fd, unsigned int &cols, unsigned int &rows) {
+    winsize ws{};
+    if (ioctl(fd, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) return false;
+
+    cols = ws.ws_col;
+    rows = ws.ws_row;
+    return true;
+}
+
+// Switches to the alternate screen, so whatever the user had on screen is left alone, and hides the cursor. The
+// alternate screen itself is cleared by the first draw, since that's when we learn the fire's size.
+void TerminalRenderer::begin() {
+    _cols = 0;
+    _rows = 0;
+    _buffer.clear();
+    _buffer += "\x1b[?1049h\x1b[?25l";
+    _flush();
+}
+
+// Restores the terminal's colours and cursor and switches back to the screen the user had before begin().
+void TerminalRenderer::end() {
+    _buffer.clear();
+    _buffer += "\x1b[0m\x1b[?25h\x1b[?1049l";
+    _flush();
+}
+
+// Forgets what we think is on screen. The next draw clears the screen and repaints every cell. Needed whenever
+// something other than the fire's cells changes what the terminal shows, e.g. a new palette, or a resize after which
+// the terminal may have reflowed or kept cells outside the fire.
+void TerminalRenderer::invalidate() {
+    _cols = 0;
+    _rows = 0;
+}
+
+// Builds the escape codes for every changed cell and writes them out in one go.
+void TerminalRenderer::draw(const DoomFire &fire) {
+    const size_t width = fire.getWidth();
+    const size_t height = fire.getHeight();
+    const size_t rows = (height + 1) / 2;
+    const std::vector<sf::Color> &palette = fire.getPalette();
+
+    _buffer.clear();
+
+    if (width != _cols || rows != _rows) {
+        _cols = width;
+        _rows = rows;
+        _screen.assign(_cols * _rows, UNKNOWN_CELL);
+        _fg_known = false;
+        _bg_known = false;
+        _buffer += "\x1b[0m\x1b[2J";
+    }
+
+    for (size_t row = 0; row < _rows; row++) {
+        const size_t top_y = row * 2;
+        const size_t bottom_y = top_y + 1;
+
+        // Where the terminal's cursor is on this row, or _cols if we haven't written to this row yet this frame.
+        size_t cursor = _cols;
+
+        for (size_t col = 0; col < _cols; col++) {
+            const size_t top = fire.getCell(top_y * width + col);
+            // With an odd height the last row only has a top pixel, so the bottom half is drawn as palette index 0.
+            const size_t bottom = bottom_y < height ? fire.getCell(bottom_y * width + col) : 0;
+
+            const uint64_t packed = ((uint64_t) top << 32u) | (uint64_t) bottom;
+            uint64_t &on_screen = _screen[row * _cols + col];
+            if (on_screen == packed) continue;
+            on_screen = packed;
+
+            if (cursor < col) {
+                // Skipping ahead on the same row is cheaper than an absolute move.
+                _buffer += "\x1b[";
+                _appendNumber(col - cursor);
+                _buffer += 'C';
+            } else if (cursor != col) {
+                _moveTo(row, col);
+            }
+
+            const sf::Color &top_color = palette[top];
+            const sf::Color &bottom_color = palette[bottom];
+
+            if (top_color == bottom_color) {
+                // A solid cell only needs a background colour, which lets runs of flat colour share one escape code
+                // regardless of the foreground.
+                if (!_bg_known || _bg != bottom_color) {
+                    _buffer += "\x1b[48;2;";
+                    _appendColor(bottom_color);
+                    _buffer += 'm';
+                    _bg = bottom_color;
+                    _bg_known = true;
+                }
+                _buffer += ' ';
+            } else {
+                const bool fg_changed = !_fg_known || _fg != top_color;
+                const bool bg_changed = !_bg_known || _bg != bottom_color;
+
+                if (fg_changed || bg_changed) {
+                    _buffer += "\x1b[";
+                    if (fg_changed) {
+                        _buffer += "38;2;";
+                        _appendColor(top_color);
+                    }
+                    if (fg_changed && bg_changed) _buffer += ';';
+                    if (bg_changed) {
+                        _buffer += "48;2;";
+                        _appendColor(bottom_color);
+                    }
+                    _buffer += 'm';
+
+                    _fg = top_color;
+                    _bg = bottom_color;
+                    _fg_known = true;
+                    _bg_known = true;
+                }
+                _buffer += HALF_BLOCK;
+            }
+
+            cursor = col + 1;
+        }
+    }
+
+    _last_frame_bytes = _buffer.size();
+    _flush();
+}
+
+// Appends a number in decimal. Avoids going through streams since this runs several times per changed cell.
+void TerminalRenderer::_appendNumber(size_t n) {
+    char digits[20];
+    size_t count = 0;
+
+    do {
+        digits[count++] = (char) ('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+
+    while (count > 0) _buffer += digits[--count];
+}
+
+// Appends the `r;g;b` part of a truecolor escape code.
+void TerminalRenderer::_appendColor(const sf::Color &color) {
+    _appendNumber(color.r);
+    _buffer += ';';
+    _appendNumber(color.g);
+    _buffer += ';';
+    _appendNumber(color.b);
+}
+
+// Moves the cursor to a zero based row and column.
+void TerminalRenderer::_moveTo(const size_t row, const size_t col) {
+    _buffer += "\x1b[";
+    _appendNumber(row + 1);
+    _buffer += ';';
+    _appendNumber(col + 1);
+    _buffer += 'H';
+}
+
+// Writes the whole buffer with a single write() call. Only loops if the kernel accepts a partial write.
+void TerminalRenderer::_flush() {
+    const char *data = _buffer.data();
+    size_t remaining = _buffer.size();
+
+    while (remaining > 0) {
+        const ssize_t written = write(_fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        data += written;
+        remaining -= (size_t) written;
+    }
+
+    _buffer.clear();
+}
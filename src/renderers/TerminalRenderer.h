@@ -0,0 +1,59 @@
+#ifndef DOOMFIRE_TERMINALRENDERER_H
+#define DOOMFIRE_TERMINALRENDERER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics/Color.hpp>
+
+#include "../effects/DoomFire.h"
+
+// Draws the fire into a terminal using 24-bit ANSI colour escapes. Every character cell shows two pixels by drawing the
+// upper half block glyph with the top pixel as foreground and the bottom pixel as background.
+// Only cells which changed since the previous frame are emitted, so the bytes written per frame scale with how much of
+// the fire moved rather than with the size of the terminal.
+class TerminalRenderer {
+public:
+    explicit TerminalRenderer(int fd);
+
+    void begin();
+
+    void end();
+
+    void draw(const DoomFire &);
+
+    void invalidate();
+
+    size_t lastFrameBytes() const { return _last_frame_bytes; }
+
+    static bool querySize(int fd, unsigned int &cols, unsigned int &rows);
+
+private:
+    int _fd;
+    size_t _cols = 0;
+    size_t _rows = 0;
+    size_t _last_frame_bytes = 0;
+
+    // What we believe is on screen. One packed (top, bottom) palette index pair per character cell.
+    std::vector<uint64_t> _screen;
+
+    // The colours the terminal is currently set to, so runs of identical colours don't repeat their escape codes.
+    bool _fg_known = false;
+    bool _bg_known = false;
+    sf::Color _fg;
+    sf::Color _bg;
+
+    std::string _buffer;
+
+    void _appendNumber(size_t);
+
+    void _appendColor(const sf::Color &);
+
+    void _moveTo(size_t row, size_t col);
+
+    void _flush();
+};
+
+
+#endif //DOOMFIRE_TERMINALRENDERER_H
@@ -0,0 +1,194 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <SFML/Graphics/Image.hpp>
+
+#include "ImageSequenceExporter.h"
+#include "../libs/FileUtils.h"
+
+ImageSequenceExporter::ImageSequenceExporter(
+        std::string directory,
+        const ImageFormat::ImageFormat format,
+        const size_t encoder_threads,
+        const size_t queue_depth
+) {
+    _directory = std::move(directory);
+    _format = format;
+    _encoder_threads = encoder_threads ? encoder_threads : 1;
+    _queue_depth = queue_depth ? queue_depth : 1;
+}
+
+ImageSequenceExporter::~ImageSequenceExporter() {
+    finish();
+}
+
+// Creates the output directory (if needed) and spins up the encoder threads.
+bool ImageSequenceExporter::start(const std::vector<sf::Color> &palette) {
+    if (!FileUtils::makeDirectory(_directory)) {
+        _error = "mkdir(" + _directory + "): " + std::strerror(errno);
+        return false;
+    }
+
+    _palette = palette;
+    _frame_number = 0;
+
+    for (size_t i = 0; i < _encoder_threads; i++) _encoders.emplace_back(&ImageSequenceExporter::_encode, this);
+
+    return true;
+}
+
+// Copies the fire's current palette indices into the queue. Blocks while the encoders are `queue_depth` frames behind,
+// which keeps memory use bounded no matter how much faster the simulation is than the encoders.
+bool ImageSequenceExporter::push(const DoomFire &fire) {
+    Snapshot snapshot;
+    snapshot.number = _frame_number++;
+    snapshot.width = fire.getWidth();
+    snapshot.height = fire.getHeight();
+    snapshot.bytes_per_cell = fireCellSize(_palette.size());
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_spare_buffers.empty()) {
+            snapshot.cells = std::move(_spare_buffers.back());
+            _spare_buffers.pop_back();
+        }
+    }
+
+    const size_t pixels = snapshot.width * snapshot.height;
+    snapshot.cells.resize(pixels * snapshot.bytes_per_cell);
+
+    switch (snapshot.bytes_per_cell) {
+        case sizeof(uint8_t):
+            for (size_t i = 0; i < pixels; i++) snapshot.cells[i] = (uint8_t) fire.getCell(i);
+            break;
+        case sizeof(uint16_t):
+            for (size_t i = 0; i < pixels; i++) {
+                const auto palette_idx = (uint16_t) fire.getCell(i);
+                std::memcpy(&snapshot.cells[i * sizeof(palette_idx)], &palette_idx, sizeof(palette_idx));
+            }
+            break;
+        default:
+            for (size_t i = 0; i < pixels; i++) {
+                const auto palette_idx = (uint32_t) fire.getCell(i);
+                std::memcpy(&snapshot.cells[i * sizeof(palette_idx)], &palette_idx, sizeof(palette_idx));
+            }
+            break;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [this] { return _queue.size() < _queue_depth || _failed; });
+    if (_failed) return false;
+
+    _queue.push_back(std::move(snapshot));
+    _not_empty.notify_one();
+
+    return true;
+}
+
+// Waits for every queued frame to be written and stops the encoders. Returns false if any frame failed to write.
+bool ImageSequenceExporter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+    }
+    _not_empty.notify_all();
+
+    for (auto &encoder : _encoders) encoder.join();
+    _encoders.clear();
+
+    return !_failed;
+}
+
+// Body of each encoder thread. Takes frames off the queue until it's closed and drained.
+void ImageSequenceExporter::_encode() {
+    std::vector<uint8_t> pixels; // Colorized frame, reused between frames.
+
+    while (true) {
+        Snapshot snapshot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this] { return !_queue.empty() || _closed || _failed; });
+            if (_queue.empty() || _failed) return;
+
+            snapshot = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        _not_full.notify_one();
+
+        const bool written = _write(snapshot, pixels);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _spare_buffers.push_back(std::move(snapshot.cells));
+        if (!written) return;
+    }
+}
+
+// Colorizes a single frame and writes it to disk. PNGs go through SFML, PPMs are simple enough to write by hand.
+bool ImageSequenceExporter::_write(const Snapshot &snapshot, std::vector<uint8_t> &pixels) {
+    const size_t pixel_count = snapshot.width * snapshot.height;
+    const size_t channels = _format == ImageFormat::PNG ? 4 : 3;
+    pixels.resize(pixel_count * channels);
+
+    for (size_t i = 0; i < pixel_count; i++) {
+        size_t palette_idx;
+        if (snapshot.bytes_per_cell == sizeof(uint8_t)) {
+            palette_idx = snapshot.cells[i];
+        } else if (snapshot.bytes_per_cell == sizeof(uint16_t)) {
+            uint16_t wide_idx;
+            std::memcpy(&wide_idx, &snapshot.cells[i * sizeof(wide_idx)], sizeof(wide_idx));
+            palette_idx = wide_idx;
+        } else {
+            uint32_t wide_idx;
+            std::memcpy(&wide_idx, &snapshot.cells[i * sizeof(wide_idx)], sizeof(wide_idx));
+            palette_idx = wide_idx;
+        }
+
+        const sf::Color &color = _palette[palette_idx];
+        uint8_t *pixel = &pixels[i * channels];
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+        if (channels == 4) pixel[3] = color.a;
+    }
+
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "/%06zu.%s", snapshot.number,
+                  _format == ImageFormat::PNG ? "png" : "ppm");
+    const std::string path = _directory + file_name;
+
+    if (_format == ImageFormat::PNG) {
+        sf::Image image;
+        image.create(snapshot.width, snapshot.height, pixels.data());
+        if (!image.saveToFile(path)) {
+            _fail("failed to write " + path);
+            return false;
+        }
+    } else {
+        FILE *file = std::fopen(path.c_str(), "wb");
+        bool ok = file != nullptr;
+        if (ok) {
+            ok = std::fprintf(file, "P6\n%zu %zu\n255\n", snapshot.width, snapshot.height) > 0;
+            ok = ok && std::fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+            ok = (std::fclose(file) == 0) && ok;
+        }
+
+        if (!ok) {
+            _fail(path + ": " + std::strerror(errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Records the first error and wakes everyone up so the export stops early.
+void ImageSequenceExporter::_fail(const std::string &error) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_failed) _error = error;
+        _failed = true;
+    }
+    _not_empty.notify_all();
+    _not_full.notify_all();
+}
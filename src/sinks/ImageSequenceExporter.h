@@ -0,0 +1,79 @@
+#ifndef DOOMFIRE_IMAGESEQUENCEEXPORTER_H
+#define DOOMFIRE_IMAGESEQUENCEEXPORTER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/Graphics/Color.hpp>
+
+#include "../effects/DoomFire.h"
+#include "../libs/Options.h"
+
+// Writes frames of the fire to numbered image files. The simulation thread only copies the palette indices of each
+// frame into a bounded queue, a pool of encoder threads turns them into colours and writes the files. This keeps the
+// slow part (compression and IO) off the simulation thread and spreads it over as many cores as we're given.
+class ImageSequenceExporter {
+public:
+    ImageSequenceExporter(
+            std::string directory,
+            ImageFormat::ImageFormat format,
+            size_t encoder_threads,
+            size_t queue_depth
+    );
+
+    ImageSequenceExporter(const ImageSequenceExporter &) = delete;
+
+    ImageSequenceExporter &operator=(const ImageSequenceExporter &) = delete;
+
+    ~ImageSequenceExporter();
+
+    bool start(const std::vector<sf::Color> &palette);
+
+    bool push(const DoomFire &);
+
+    bool finish();
+
+    const std::string &getError() const { return _error; }
+
+private:
+    // Palette indices of one frame, using the same cell size as the simulation (see fireCellSize()).
+    struct Snapshot {
+        size_t number = 0;
+        size_t width = 0;
+        size_t height = 0;
+        size_t bytes_per_cell = 1;
+        std::vector<uint8_t> cells;
+    };
+
+    std::string _directory;
+    ImageFormat::ImageFormat _format;
+    size_t _encoder_threads;
+    size_t _queue_depth;
+
+    std::vector<sf::Color> _palette;
+    size_t _frame_number = 0;
+
+    std::vector<std::thread> _encoders;
+    std::mutex _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+    std::deque<Snapshot> _queue;
+    std::vector<std::vector<uint8_t>> _spare_buffers;
+    bool _closed = false;
+    bool _failed = false;
+    std::string _error;
+
+    void _encode();
+
+    bool _write(const Snapshot &, std::vector<uint8_t> &pixels);
+
+    void _fail(const std::string &);
+};
+
+
+#endif //DOOMFIRE_IMAGESEQUENCEEXPORTER_H
@@ -0,0 +1,96 @@
+#ifndef DOOMFIRE_SHAREDMEMORYPROTOCOL_H
+#define DOOMFIRE_SHAREDMEMORYPROTOCOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the shared memory segment published by `--shm`. This header has no dependencies outside the standard
+// library so that other programs can include it as is.
+//
+// The segment starts with a ShmHeader, followed by `slot_count` slots of `slot_size` bytes each. Every slot starts with
+// a ShmSlotHeader, followed by the frame's palette indices (uint16_t per pixel) at `indices_offset` and its RGBA pixels
+// (4 bytes per pixel) at `rgba_offset`. Both are stored row by row, top to bottom.
+//
+// Frame n is written to slot n % slot_count. Each slot is guarded by a seqlock: the writer makes `sequence` odd while
+// it writes and even again once the frame is complete. Readers map the segment read-only and read frames in place:
+//
+//      const ShmSlotHeader *slot = shmLatestSlot(header);
+//      uint32_t seq;
+//      if (shmBeginRead(slot, seq)) {
+//          ... use the pixels ...
+//          if (shmEndRead(slot, seq)) { the frame was not overwritten while we read it }
+//      }
+//
+// With N slots a reader has roughly N - 1 frame periods to finish with a frame before it gets overwritten.
+
+static const char SHM_MAGIC[8] = {'D', 'O', 'O', 'M', 'F', 'I', 'R', 'E'};
+static const uint32_t SHM_VERSION = 1;
+static const size_t SHM_ALIGNMENT = 64;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory frames need lock free atomics to be usable across processes");
+
+struct ShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t indices_offset;
+    uint32_t rgba_offset;
+    // Largest frame a slot can hold. Actual frames may be smaller, see ShmSlotHeader.
+    uint32_t max_width;
+    uint32_t max_height;
+    // Process publishing into this ring. Lets a new publisher tell a live ring from one left behind by a crash.
+    uint32_t owner_pid;
+    // Number of the newest complete frame plus one. 0 means nothing has been published yet.
+    std::atomic<uint64_t> frames_published;
+};
+
+struct alignas(SHM_ALIGNMENT) ShmSlotHeader {
+    std::atomic<uint32_t> sequence;
+    uint32_t width;
+    uint32_t height;
+    uint32_t palette_size;
+    uint64_t frame;
+};
+
+inline const ShmSlotHeader *shmSlot(const ShmHeader *header, size_t index) {
+    const auto *base = reinterpret_cast<const unsigned char *>(header);
+    const size_t header_size = (sizeof(ShmHeader) + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+
+    return reinterpret_cast<const ShmSlotHeader *>(base + header_size + index * header->slot_size);
+}
+
+// The slot holding the newest frame, or nullptr if no frame has been published yet.
+inline const ShmSlotHeader *shmLatestSlot(const ShmHeader *header) {
+    const uint64_t published = header->frames_published.load(std::memory_order_acquire);
+    if (published == 0) return nullptr;
+
+    return shmSlot(header, (published - 1) % header->slot_count);
+}
+
+inline const uint16_t *shmIndices(const ShmHeader *header, const ShmSlotHeader *slot) {
+    return reinterpret_cast<const uint16_t *>(reinterpret_cast<const unsigned char *>(slot) + header->indices_offset);
+}
+
+inline const uint8_t *shmRgba(const ShmHeader *header, const ShmSlotHeader *slot) {
+    return reinterpret_cast<const unsigned char *>(slot) + header->rgba_offset;
+}
+
+// Starts reading a slot. Returns false if the writer is in the middle of updating it.
+inline bool shmBeginRead(const ShmSlotHeader *slot, uint32_t &sequence) {
+    sequence = slot->sequence.load(std::memory_order_acquire);
+
+    return (sequence & 1u) == 0;
+}
+
+// Finishes reading a slot. Returns false if the writer touched the slot since shmBeginRead, in which case whatever was
+// read must be thrown away.
+inline bool shmEndRead(const ShmSlotHeader *slot, const uint32_t sequence) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+#endif //DOOMFIRE_SHAREDMEMORYPROTOCOL_H
@@ -0,0 +1,201 @@
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SharedMemorySink.h"
+
+static size_t alignUp(const size_t n) {
+    return (n + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+}
+
+SharedMemorySink::~SharedMemorySink() {
+    close();
+}
+
+// Creates a new shared memory object and maps it, replacing one only if a previous publisher left it behind. Slots are sized for frames up to
+// max_width * max_height. Returns false and sets the error message on failure.
+bool SharedMemorySink::open(const std::string &name, const size_t max_width, const size_t max_height,
+                            const size_t slot_count) {
+    close();
+    _error.clear();
+
+    // shm_open wants names of the form `/something`.
+    _name = (!name.empty() && name[0] == '/') ? name : "/" + name;
+
+    if (slot_count == 0) {
+        _error = "shared memory ring needs at least one slot";
+        return false;
+    }
+
+    const size_t pixels = max_width * max_height;
+    const size_t indices_offset = alignUp(sizeof(ShmSlotHeader));
+    const size_t rgba_offset = indices_offset + alignUp(pixels * sizeof(uint16_t));
+    const size_t slot_size = rgba_offset + alignUp(pixels * 4);
+
+    if (slot_size > std::numeric_limits<uint32_t>::max()) {
+        _error = "frames are too large for a shared memory slot";
+        return false;
+    }
+
+    _mapped_size = alignUp(sizeof(ShmHeader)) + slot_count * slot_size;
+
+    // Only ever create a fresh object. An existing one is removed only if it's a ring whose publisher has exited.
+    int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && _removeStale()) fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        if (_error.empty()) _error = "shm_open(" + _name + "): " + std::strerror(errno);
+        return false;
+    }
+
+    if (ftruncate(fd, (off_t) _mapped_size) != 0) {
+        _error = "ftruncate(" + _name + "): " + std::strerror(errno);
+        ::close(fd);
+        shm_unlink(_name.c_str());
+        return false;
+    }
+
+    void *memory = mmap(nullptr, _mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the object alive.
+
+    if (memory == MAP_FAILED) {
+        _error = "mmap(" + _name + "): " + std::strerror(errno);
+        shm_unlink(_name.c_str());
+        return false;
+    }
+
+    _header = new(memory) ShmHeader();
+    _header->version = SHM_VERSION;
+    _header->owner_pid = (uint32_t) getpid();
+    _header->slot_count = (uint32_t) slot_count;
+    _header->slot_size = (uint32_t) slot_size;
+    _header->indices_offset = (uint32_t) indices_offset;
+    _header->rgba_offset = (uint32_t) rgba_offset;
+    _header->max_width = (uint32_t) max_width;
+    _header->max_height = (uint32_t) max_height;
+
+    for (size_t i = 0; i < slot_count; i++) new(_slot(i)) ShmSlotHeader();
+
+    // The magic goes in last so that a reader never sees a valid looking header with garbage behind it.
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(_header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+
+    _frame = 0;
+    _error.clear();
+    return true;
+}
+
+// Unmaps and removes the shared memory object. Readers that already mapped it keep their mapping.
+void SharedMemorySink::close() {
+    if (_header == nullptr) return;
+
+    munmap(_header, _mapped_size);
+    shm_unlink(_name.c_str());
+
+    _header = nullptr;
+    _mapped_size = 0;
+}
+
+// Removes an existing object under our name, but only if it's a DoomFire ring whose publisher is gone. Returns false and
+// sets the error message if it belongs to a running publisher or isn't ours to remove.
+bool SharedMemorySink::_removeStale() {
+    const int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return errno == ENOENT; // Somebody else removed it in the meantime.
+
+    struct stat st{};
+    pid_t owner = 0;
+    bool is_ring = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(ShmHeader);
+    if (is_ring) {
+        void *memory = mmap(nullptr, sizeof(ShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+        is_ring = memory != MAP_FAILED;
+        if (is_ring) {
+            const auto *header = static_cast<const ShmHeader *>(memory);
+            is_ring = std::memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) == 0;
+            owner = (pid_t) header->owner_pid;
+            munmap(memory, sizeof(ShmHeader));
+        }
+    }
+    ::close(fd);
+
+    if (!is_ring) {
+        _error = _name + " already exists and isn't a DoomFire frame ring, not replacing it";
+        return false;
+    }
+
+    // kill() with signal 0 only checks whether the process exists. EPERM means it exists but isn't ours.
+    if (owner != 0 && (kill(owner, 0) == 0 || errno == EPERM)) {
+        _error = _name + " is in use by running process " + std::to_string(owner);
+        return false;
+    }
+
+    return shm_unlink(_name.c_str()) == 0 || errno == ENOENT;
+}
+
+ShmSlotHeader *SharedMemorySink::_slot(const size_t index) {
+    return const_cast<ShmSlotHeader *>(shmSlot(_header, index));
+}
+
+// Whether frames of this size fit in the slots. The ring is sized once, when it's opened, since readers map it once.
+bool SharedMemorySink::fits(const size_t width, const size_t height) const {
+    return _header != nullptr && width <= _header->max_width && height <= _header->max_height;
+}
+
+// Writes the fire's current frame into the next slot of the ring. The pixels are colorized straight into shared memory
+// so there's no intermediate copy. Returns false if the frame doesn't fit.
+bool SharedMemorySink::publish(const DoomFire &fire) {
+    if (_header == nullptr) return false;
+
+    const size_t width = fire.getWidth();
+    const size_t height = fire.getHeight();
+    const std::vector<sf::Color> &palette = fire.getPalette();
+
+    if (!fits(width, height)) {
+        _error = "frame is larger than the shared memory slots";
+        return false;
+    }
+
+    if (palette.size() > (size_t) std::numeric_limits<uint16_t>::max() + 1) {
+        _error = "palette is too large to publish as 16 bit indices";
+        return false;
+    }
+
+    ShmSlotHeader *slot = _slot(_frame % _header->slot_count);
+    auto *slot_bytes = reinterpret_cast<unsigned char *>(slot);
+    auto *indices = reinterpret_cast<uint16_t *>(slot_bytes + _header->indices_offset);
+    uint8_t *rgba = slot_bytes + _header->rgba_offset;
+
+    // Odd sequence: readers back off until we're done.
+    const uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->width = (uint32_t) width;
+    slot->height = (uint32_t) height;
+    slot->palette_size = (uint32_t) palette.size();
+    slot->frame = _frame;
+
+    const size_t pixels = width * height;
+    for (size_t i = 0; i < pixels; i++) {
+        const size_t palette_idx = fire.getCell(i);
+        const sf::Color &color = palette[palette_idx];
+
+        indices[i] = (uint16_t) palette_idx;
+        rgba[i * 4 + 0] = color.r;
+        rgba[i * 4 + 1] = color.g;
+        rgba[i * 4 + 2] = color.b;
+        rgba[i * 4 + 3] = color.a;
+    }
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+
+    _frame++;
+    _header->frames_published.store(_frame, std::memory_order_release);
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef DOOMFIRE_SHAREDMEMORYSINK_H
+#define DOOMFIRE_SHAREDMEMORYSINK_H
+
+#include <string>
+
+#include "SharedMemoryProtocol.h"
+#include "../effects/DoomFire.h"
+
+// Publishes every frame of the fire into a POSIX shared memory ring so that other processes on the same machine can
+// read them without copies or syscalls. See SharedMemoryProtocol.h for the layout.
+class SharedMemorySink {
+public:
+    SharedMemorySink() = default;
+
+    SharedMemorySink(const SharedMemorySink &) = delete;
+
+    SharedMemorySink &operator=(const SharedMemorySink &) = delete;
+
+    ~SharedMemorySink();
+
+    bool open(const std::string &name, size_t max_width, size_t max_height, size_t slot_count);
+
+    void close();
+
+    bool publish(const DoomFire &);
+
+    bool fits(size_t width, size_t height) const;
+
+    const std::string &getError() const { return _error; }
+
+private:
+    std::string _name;
+    std::string _error;
+    ShmHeader *_header = nullptr;
+    size_t _mapped_size = 0;
+    uint64_t _frame = 0;
+
+    ShmSlotHeader *_slot(size_t index);
+
+    bool _removeStale();
+};
+
+
+#endif //DOOMFIRE_SHAREDMEMORYSINK_H